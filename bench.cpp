@@ -0,0 +1,575 @@
+#include <map>
+#include <memory>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "lfsr.hpp"
+#include "rc4.hpp"
+#include "geffe.hpp"
+#include "philox.hpp"
+#include "BitStreamTests.hpp"
+#include "rc5plus.hpp"
+#include "rc5plus2.hpp"
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+namespace {
+    using namespace std;
+
+    typedef chrono::steady_clock Clock;
+
+    /**
+     * The timed part of a workload: it runs the kernel once and returns how many units it processed.
+     */
+    typedef function<uint64_t()> Step;
+
+    /**
+     * One workload.  setup() builds the buffers, keys and state from the generator it is handed, outside the timed
+     * region, and returns the step that the harness times.  Steps that consume state start each call from a copy of
+     * it, so every repetition of a micro-benchmark sees the same inputs; the macro-benchmarks draw as they go, like
+     * the demos, so each repetition sees the next inputs of a fixed sequence.  A step should take at least 100 ms.
+     */
+    struct Benchmark {
+        string name;
+        string unit;
+        function<Step(Philox)> setup;
+    };
+
+    struct Result {
+        string name;
+        string unit;
+        vector<double> seconds = {};
+        vector<double> rates = {};
+        double medianSeconds = 0;
+        double median = 0;
+        double stddev = 0;
+    };
+
+    struct Options {
+        uint64_t seed = 0x6d7363;
+        int warmup = 1;
+        int repetitions = 5;
+        double threshold = 0.1;
+        string filter;
+        string jsonPath;
+        string baselinePath;
+        bool list = false;
+    };
+
+    /**
+     * Results are folded into this so that the optimizer cannot drop the work that produced them.
+     */
+    uint64_t volatile sink;
+
+    /**
+     * Swallows std::cout while a workload runs, for the demo code that reports its progress there.
+     */
+    struct NullBuffer : streambuf {
+        int overflow(int c) override {
+            return c;
+        }
+    };
+
+    class Silence {
+        NullBuffer null_;
+        streambuf *saved_;
+
+    public:
+        Silence() : null_(), saved_(cout.rdbuf(&null_)) {
+        }
+
+        ~Silence() {
+            cout.rdbuf(saved_);
+        }
+    };
+
+    /**
+     * The stream a benchmark draws its inputs from, chosen by name (FNV-1a) so that adding, removing or filtering
+     * benchmarks leaves the inputs of the others unchanged.
+     */
+    uint64_t streamOf(string const &name) {
+        uint64_t h = 0xcbf29ce484222325;
+        for (unsigned char c : name) {
+            h ^= c;
+            h *= 0x100000001b3;
+        }
+        return h;
+    }
+
+    double median(vector<double> v) {
+        sort(v.begin(), v.end());
+        auto n = v.size();
+        return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    }
+
+    double stddev(vector<double> const &v) {
+        if (v.size() < 2) {
+            return 0;
+        }
+        double mean = 0;
+        for (auto x : v) {
+            mean += x;
+        }
+        mean /= v.size();
+        double sum = 0;
+        for (auto x : v) {
+            sum += (x - mean) * (x - mean);
+        }
+        return sqrt(sum / (v.size() - 1));
+    }
+
+    /**
+     * Keeps value, and everything written through it, alive without the cost of a store through sink.  Compilers
+     * without GNU inline assembly fall back to storing two of its bytes there.
+     */
+    template<class T>
+    void keep(T const &value) {
+#if defined(__GNUC__)
+        asm volatile("" : : "r"(&value) : "memory");
+#else
+        auto bytes = reinterpret_cast<unsigned char const *>(&value);
+        sink = bytes[0] ^ bytes[sizeof(T) - 1];
+#endif
+    }
+
+    template<int n>
+    Benchmark lfsrNext() {
+        return {"lfsr/next/" + to_string(n), "bits", [](Philox prng) -> Step {
+            Lfsr<n> initial(1 + prng() % ((1 << n) - 1));
+            return [initial]() {
+                auto lfsr = initial;
+                uint64_t ones = 0;
+                for (int i = 0; i < 1 << 26; ++i) {
+                    ones += lfsr.next();
+                }
+                sink = ones;
+                return uint64_t(1) << 26;
+            };
+        }};
+    }
+
+    Rc4::Key randomRc4Key(Philox &prng) {
+        Rc4::Key key;
+        generate(key.begin(), key.end(), [&]() { return uint8_t(prng()); });
+        return key;
+    }
+
+    /**
+     * A keystream of the Geffe generator from geffe.cpp under random nonzero IVs.
+     */
+    vector<bool> randomGeffeKeystream(Philox &prng, size_t length) {
+        Geffe<3, 4, 5> geffe(1 + prng() % 7, 1 + prng() % 15, 1 + prng() % 31);
+        vector<bool> result;
+        generate_n(back_inserter(result), length, bind(&Geffe<3, 4, 5>::next, &geffe));
+        return result;
+    }
+
+    /**
+     * 2^20 random plaintexts for the rc5plus ciphers, one word per block.
+     */
+    shared_ptr<vector<uint32_t> const> randomWords(Philox &prng) {
+        auto words = make_shared<vector<uint32_t>>(1 << 20);
+        prng.fill(words->data(), words->size());
+        return words;
+    }
+
+    /**
+     * The test and its bit source are rebuilt on each call, which costs a handful of stores against the 2^bits
+     * observations.
+     */
+    template<template<int> class Test>
+    Benchmark sequenceTest(string const &name, int bits) {
+        return {name, "observations", [bits](Philox prng) -> Step {
+            Lfsr<24> initial(1 + prng() % ((1 << 24) - 1));
+            return [initial, bits]() {
+                auto lfsr = initial;
+                Test<5> test(bind(&Lfsr<24>::next, &lfsr));
+                for (int i = 0; i < 1 << bits; ++i) {
+                    test.extractObservation();
+                }
+                sink = uint64_t(test.chiSquaredPValue() * 1e9);
+                return uint64_t(1) << bits;
+            };
+        }};
+    }
+
+    vector<Benchmark> benchmarks() {
+        return {
+                {"philox/fill", "words", [](Philox prng) -> Step {
+                    auto words = make_shared<vector<uint32_t>>(1 << 20);
+                    return [prng, words]() {
+                        auto generator = prng;
+                        for (int pass = 0; pass < 64; ++pass) {
+                            generator.fill(words->data(), words->size());
+                            keep(words->back());
+                        }
+                        return uint64_t(64) * words->size();
+                    };
+                }},
+                lfsrNext<5>(),
+                lfsrNext<16>(),
+                lfsrNext<24>(),
+                {"rc4/ksa", "bytes", [](Philox prng) -> Step {
+                    auto initial = randomRc4Key(prng);
+                    return [initial]() {
+                        auto key = initial;
+                        for (int i = 0; i < 1 << 17; ++i) {
+                            key[i % Rc4::m] ^= uint8_t(i);
+                            Rc4 rc4(key);
+                            keep(rc4);
+                        }
+                        return uint64_t(256) << 17;
+                    };
+                }},
+                {"rc4/next", "bytes", [](Philox prng) -> Step {
+                    Rc4 initial(randomRc4Key(prng));
+                    return [initial]() {
+                        auto rc4 = initial;
+                        uint64_t sum = 0;
+                        for (int i = 0; i < 1 << 25; ++i) {
+                            sum += rc4.next();
+                        }
+                        sink = sum;
+                        return uint64_t(1) << 25;
+                    };
+                }},
+                {"geffe/next", "bits", [](Philox prng) -> Step {
+                    Geffe<3, 4, 5> initial(1 + prng() % 7, 1 + prng() % 15, 1 + prng() % 31);
+                    return [initial]() {
+                        auto geffe = initial;
+                        uint64_t ones = 0;
+                        for (int i = 0; i < 1 << 25; ++i) {
+                            ones += geffe.next();
+                        }
+                        sink = ones;
+                        return uint64_t(1) << 25;
+                    };
+                }},
+                {"rc5plus/encrypt", "blocks", [](Philox prng) -> Step {
+                    using namespace rc5plus;
+                    Keys keys;
+                    generate_n(back_inserter(keys), 6, [&]() { return HalfBlock(prng()); });
+                    auto words = randomWords(prng);
+                    auto result = make_shared<Blocks>();
+                    return [keys, words, result]() {
+                        uint64_t sum = 0;
+                        for (int pass = 0; pass < 16; ++pass) {
+                            for (auto w : *words) {
+                                encrypt(keys, Block(HalfBlock(w >> 16), HalfBlock(w)), *result);
+                                sum += get<1>(result->back());
+                            }
+                        }
+                        sink = sum;
+                        return uint64_t(16) * words->size();
+                    };
+                }},
+                {"rc5plus2/Cipher::encrypt", "blocks", [](Philox prng) -> Step {
+                    using namespace rc5plus2;
+                    auto cipher = make_shared<Cipher>(randomKeySchedule(prng));
+                    auto words = randomWords(prng);
+                    auto result = make_shared<Blocks>();
+                    return [cipher, words, result]() {
+                        uint64_t sum = 0;
+                        for (int pass = 0; pass < 8; ++pass) {
+                            for (auto w : *words) {
+                                cipher->encrypt(Block(HalfBlock(w >> 16), HalfBlock(w)), *result);
+                                sum += get<1>(result->back());
+                            }
+                        }
+                        sink = sum;
+                        return uint64_t(8) * words->size();
+                    };
+                }},
+                sequenceTest<PokerTest>("bitstream/PokerTest<5>", 23),
+                sequenceTest<SerialTest>("bitstream/SerialTest<5>", 25),
+                {"geffe/guessIv<5>", "calls", [](Philox prng) -> Step {
+                    auto keystream = make_shared<vector<bool> const>(randomGeffeKeystream(prng, 32));
+                    return [keystream]() {
+                        uint64_t sum = 0;
+                        for (int i = 0; i < 1 << 15; ++i) {
+                            sum += guessIv<5>(*keystream);
+                        }
+                        sink = sum;
+                        return uint64_t(1) << 15;
+                    };
+                }},
+                {"geffe/bruteForce", "calls", [](Philox prng) -> Step {
+                    auto keystream = make_shared<vector<bool> const>(randomGeffeKeystream(prng, 32));
+                    return [keystream]() {
+                        uint64_t sum = 0;
+                        for (int i = 0; i < 256; ++i) {
+                            sum += get<1>(bruteForce(*keystream));
+                        }
+                        sink = sum;
+                        return uint64_t(256);
+                    };
+                }},
+                {"rc5plus/Tester::runTest", "calls", [](Philox prng) -> Step {
+                    auto tester = make_shared<rc5plus::Tester>(prng());
+                    auto results = make_shared<vector<uint32_t>>();
+                    return [tester, results]() {
+                        for (int i = 0; i < 4; ++i) {
+                            tester->runTest(*results);
+                        }
+                        sink = results->back();
+                        return uint64_t(4);
+                    };
+                }},
+                {"rc5plus2/Attack::recoverKey10", "calls", [](Philox prng) -> Step {
+                    using namespace rc5plus2;
+                    auto state = make_shared<tuple<Philox, Cipher>>(prng, Cipher(randomKeySchedule(prng)));
+                    return [state]() {
+                        Attack attack(get<0>(*state), get<1>(*state));
+                        Silence silence;
+                        uint64_t sum = 0;
+                        for (int i = 0; i < 2; ++i) {
+                            sum += attack.recoverKey10();
+                        }
+                        sink = sum;
+                        return uint64_t(2);
+                    };
+                }},
+        };
+    }
+
+    Result measure(Benchmark const &benchmark, Options const &options) {
+        Philox root(options.seed);
+        Result result{benchmark.name, benchmark.unit};
+        auto step = benchmark.setup(root.split(streamOf(benchmark.name)));
+
+        for (int i = 0; i < options.warmup; ++i) {
+            step();
+        }
+
+        for (int i = 0; i < options.repetitions; ++i) {
+            auto start = Clock::now();
+            auto count = step();
+            double seconds = chrono::duration<double>(Clock::now() - start).count();
+            result.seconds.push_back(seconds);
+            result.rates.push_back(count / seconds);
+        }
+
+        result.medianSeconds = median(result.seconds);
+        result.median = median(result.rates);
+        result.stddev = stddev(result.rates);
+        return result;
+    }
+
+    string quoted(string const &s) {
+        string result = "\"";
+        for (char c : s) {
+            if ('"' == c || '\\' == c) {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result + '"';
+    }
+
+    void writeJson(ostream &o, Options const &options, vector<Result> const &results) {
+        o << setprecision(10);
+        o << "{\n";
+        o << "  \"seed\": " << options.seed << ",\n";
+        o << "  \"warmup\": " << options.warmup << ",\n";
+        o << "  \"repetitions\": " << options.repetitions << ",\n";
+        o << "  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto const &r = results[i];
+            o << (i ? "," : "") << "\n    {\n";
+            o << "      \"name\": " << quoted(r.name) << ",\n";
+            o << "      \"unit\": " << quoted(r.unit) << ",\n";
+            o << "      \"median\": " << r.median << ",\n";
+            o << "      \"stddev\": " << r.stddev << ",\n";
+            o << "      \"median_seconds\": " << r.medianSeconds << ",\n";
+            o << "      \"seconds\": [";
+            for (size_t j = 0; j < r.seconds.size(); ++j) {
+                o << (j ? ", " : "") << r.seconds[j];
+            }
+            o << "]\n    }";
+        }
+        o << "\n  ]\n}\n";
+    }
+
+    /**
+     * Compare against the medians of a file written by --json and report each benchmark whose median rate fell by
+     * more than the threshold.  A benchmark whose relative stddev, in this run or the baseline, exceeds the threshold
+     * is reported as too noisy instead of being flagged.  Returns the number of regressions.
+     */
+    int compare(string const &path, Options const &options, vector<Result> const &results) {
+        boost::property_tree::ptree baseline;
+        boost::property_tree::read_json(path, baseline);
+
+        map<string, tuple<double, double>> medians;
+        for (auto const &child : baseline.get_child("benchmarks")) {
+            medians[child.second.get<string>("name")] = make_tuple(child.second.get<double>("median"),
+                                                                   child.second.get<double>("stddev"));
+        }
+
+        if (baseline.get<uint64_t>("seed") != options.seed) {
+            cout << "warning: baseline was run with seed " << baseline.get<uint64_t>("seed") << endl;
+        }
+
+        int regressions = 0;
+
+        cout << endl << "compared with " << path << ":" << endl;
+        for (auto const &r : results) {
+            auto i = medians.find(r.name);
+            cout << left << setw(32) << r.name << right;
+            if (medians.end() == i) {
+                cout << "  (not in baseline)" << endl;
+                continue;
+            }
+            auto [baselineMedian, baselineStddev] = i->second;
+            double change = r.median / baselineMedian - 1;
+            double noise = max(r.stddev / r.median, baselineStddev / baselineMedian);
+            cout << showpos << fixed << setprecision(1) << setw(8) << 100 * change << '%' << noshowpos;
+            if (noise > options.threshold) {
+                cout << "  too noisy to judge (stddev " << 100 * noise << "%)";
+            } else if (change < -options.threshold) {
+                cout << "  REGRESSION";
+                ++regressions;
+            }
+            cout << endl;
+        }
+
+        cout << regressions << " regression(s) beyond " << 100 * options.threshold << '%' << endl;
+        return regressions;
+    }
+
+    void usage(ostream &o) {
+        o << "usage: msc_bench [--list] [--filter SUBSTRING] [--seed N] [--warmup N] [--repetitions N]" << endl
+          << "                 [--json FILE] [--compare BASELINE] [--threshold FRACTION]" << endl;
+    }
+
+    /**
+     * The whole of text as a non-negative number.  Trailing characters and a leading minus, which stoull would wrap,
+     * are rejected as in Philox::seedFromCommandLine(), so a mistyped option fails instead of changing the run.
+     */
+    template<class Convert>
+    auto parseNumber(string const &option, string const &text, Convert convert) {
+        try {
+            size_t end = 0;
+            auto result = convert(text, &end);
+            if (end == text.size() && '-' != text[0]) {
+                return result;
+            }
+        } catch (logic_error const &) {
+        }
+        throw invalid_argument("bad value for " + option + ": " + text);
+    }
+
+    Options parseOptions(int argc, char **argv) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            auto value = [&]() -> string {
+                if (i + 1 == argc) {
+                    throw invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if ("--list" == arg) {
+                options.list = true;
+            } else if ("--filter" == arg) {
+                options.filter = value();
+            } else if ("--seed" == arg) {
+                options.seed = parseNumber(arg, value(), [](string const &s, size_t *end) {
+                    return stoull(s, end, 0);
+                });
+            } else if ("--warmup" == arg) {
+                options.warmup = parseNumber(arg, value(), [](string const &s, size_t *end) { return stoi(s, end); });
+            } else if ("--repetitions" == arg) {
+                options.repetitions = max(1, parseNumber(arg, value(), [](string const &s, size_t *end) {
+                    return stoi(s, end);
+                }));
+            } else if ("--json" == arg) {
+                options.jsonPath = value();
+            } else if ("--compare" == arg) {
+                options.baselinePath = value();
+            } else if ("--threshold" == arg) {
+                options.threshold = parseNumber(arg, value(), [](string const &s, size_t *end) {
+                    return stod(s, end);
+                });
+            } else {
+                throw invalid_argument("unknown option " + arg);
+            }
+        }
+        return options;
+    }
+}
+
+/**
+ * Micro-benchmarks of the generators, ciphers and sequence tests, and end-to-end timings of the attacks, each
+ * reported as the median and standard deviation of its rate over the repetitions.
+ */
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (exception const &e) {
+        cerr << e.what() << endl;
+        usage(cerr);
+        return EXIT_FAILURE;
+    }
+
+    vector<Benchmark> selected;
+    for (auto &b : benchmarks()) {
+        if (string::npos != b.name.find(options.filter)) {
+            selected.push_back(b);
+        }
+    }
+
+    if (options.list) {
+        for (auto const &b : selected) {
+            cout << b.name << endl;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    cout << "seed = " << options.seed << ", warmup = " << options.warmup << ", repetitions = "
+         << options.repetitions << endl;
+    cout << left << setw(32) << "benchmark" << right << setw(14) << "median/s" << setw(9) << "stddev"
+         << setw(12) << "time" << "  unit" << endl;
+
+    vector<Result> results;
+    for (auto const &b : selected) {
+        results.push_back(measure(b, options));
+        auto const &r = results.back();
+        cout << left << setw(32) << r.name << right
+             << scientific << setprecision(3) << setw(14) << r.median
+             << fixed << setprecision(1) << setw(8) << 100 * r.stddev / r.median << '%'
+             << setprecision(3) << setw(11) << 1e3 * r.medianSeconds << "ms"
+             << "  " << r.unit << endl;
+    }
+
+    if (!options.jsonPath.empty()) {
+        ofstream json(options.jsonPath);
+        writeJson(json, options, results);
+        if (!json) {
+            cerr << "could not write " << options.jsonPath << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!options.baselinePath.empty()) {
+        try {
+            if (0 < compare(options.baselinePath, options, results)) {
+                return EXIT_FAILURE;
+            }
+        } catch (exception const &e) {
+            cerr << "could not read baseline " << options.baselinePath << ": " << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#ifndef MSC_GEFFE_HPP
+#define MSC_GEFFE_HPP
+
+#include "lfsr.hpp"
+#include "telemetry.hpp"
+#include <iostream>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <functional>
+
+template<int n, int p, int m>
+class Geffe {
+    Lfsr<n> lfsr1;
+    Lfsr<p> lfsr2;
+    Lfsr<m> lfsr3;
+
+public:
+    Geffe(std::uint64_t iv1, std::uint64_t iv2, std::uint64_t iv3) : lfsr1(iv1), lfsr2(iv2), lfsr3(iv3) {
+    }
+
+    bool next() {
+        bool x1 = lfsr1.next();
+        bool x2 = lfsr2.next();
+        bool x3 = lfsr3.next();
+        bool result = (x1 && !x2) != (x2 && x3);
+        return result;
+    }
+};
+
+template<int n>
+std::uint64_t guessIv(std::vector<bool> const &targetStream) {
+    MSC_PHASE("guessIv");
+    std::vector<bool> guessStream;
+    guessStream.reserve(targetStream.size());
+
+    std::uint64_t bestIv = 0;
+    int bestIvCount = 0;
+
+    for (std::uint64_t i = 1; i < 1 << n; ++i) {
+        guessStream.resize(0);
+        Lfsr<n> lfsr(i);
+
+        std::generate_n(std::back_inserter(guessStream), targetStream.size(), std::bind(&Lfsr<n>::next, &lfsr));
+
+        int sum = 0;
+        for (auto i = targetStream.cbegin(), j = guessStream.cbegin(); i != targetStream.end(); ++i, ++j) {
+            if (*i == *j) {
+                sum += 1;
+            }
+        }
+
+        MSC_COUNT(ivsTested, 1);
+        if (sum > bestIvCount) {
+            bestIv = i;
+            bestIvCount = sum;
+        }
+    }
+
+    return bestIv;
+}
+
+inline std::tuple<std::uint64_t, std::uint64_t, std::uint64_t>
+bruteForce(std::vector<bool> const &targetStream) {
+    MSC_PHASE("bruteForce");
+    std::vector<bool> guessStream;
+    guessStream.reserve(targetStream.size());
+
+    for (int i = 0; i < 1 << 3; ++i) {
+        for (int j = 0; j < 1 << 4; ++j) {
+            for (int k = 0; k < 1 << 5; ++k) {
+                MSC_COUNT(ivsTested, 1);
+                guessStream.resize(0);
+                Geffe<3, 4, 5> geffe(i, j, k);
+                std::generate_n(
+                        std::back_inserter(guessStream),
+                        targetStream.size(),
+                        std::bind(&Geffe<3, 4, 5>::next, &geffe)
+                );
+
+                if (guessStream == targetStream) {
+                    return std::make_tuple(i, j, k);
+                }
+            }
+        }
+    }
+
+    throw std::runtime_error("brute force attack failed");
+}
+
+#endif /* MSC_GEFFE_HPP */
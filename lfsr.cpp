@@ -1,5 +1,5 @@
 #include "lfsr.hpp"
-#include <random>
+#include "philox.hpp"
 #include <vector>
 #include "BitStreamTests.hpp"
 
@@ -33,15 +33,14 @@ void unit6_question() {
     f<5, 0b11000>(0b11011, 10, std::cout, result4b);
 }
 
-int main() {
-    std::mt19937 prng;
-    prng.seed(std::random_device()());
-    std::uniform_int_distribution<std::uint64_t> d(1, (1 << 21) - 1);
+int main(int argc, char **argv) {
+    Philox prng(Philox::seedFromCommandLine(argc, argv));
+    std::cout << "seed = " << prng.seed() << std::endl;
 
     unit6_question();
 
     typedef Lfsr<24> LfsrType;
-    LfsrType lfsr(d(prng));
+    LfsrType lfsr(1 + prng() % ((1 << 21) - 1));
 
     {
         PokerTest<5> pokerTest(std::bind(&LfsrType::next, &lfsr));
@@ -0,0 +1,188 @@
+#ifndef MSC_PHILOX_HPP
+#define MSC_PHILOX_HPP
+
+#include <array>
+#include <limits>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").  Word i of stream s is a pure function
+ * of (seed, s, i), so streams can be split off without coordination and entered at any offset, and the same seed
+ * reproduces the same inputs however the work is divided.  fill() runs the rounds over several blocks at once, laid
+ * out so that the compiler can keep each lane in a SIMD register.
+ */
+class Philox {
+public:
+    typedef std::uint32_t result_type;
+    typedef std::array<std::uint32_t, 4> Counter;
+    typedef std::array<std::uint32_t, 2> Key;
+
+private:
+    static constexpr std::uint32_t m0 = 0xd2511f53;
+    static constexpr std::uint32_t m1 = 0xcd9e8d57;
+    static constexpr std::uint32_t w0 = 0x9e3779b9;
+    static constexpr std::uint32_t w1 = 0xbb67ae85;
+    static constexpr int rounds = 10;
+    static constexpr std::size_t lanes = 8;
+
+    std::uint64_t seed_;
+    std::uint64_t stream_;
+    std::uint64_t offset_;
+    Counter block_;
+
+    /**
+     * Encrypt the counters in x in place, where x[w][j] is word w of lane j.
+     */
+    template<std::size_t n>
+    static void encrypt(std::uint32_t (&x)[4][n], Key key) {
+        for (int r = 0; r < rounds; ++r) {
+            for (std::size_t j = 0; j < n; ++j) {
+                std::uint64_t p0 = std::uint64_t(m0) * x[0][j];
+                std::uint64_t p1 = std::uint64_t(m1) * x[2][j];
+                std::uint32_t y0 = std::uint32_t(p1 >> 32) ^ x[1][j] ^ key[0];
+                std::uint32_t y2 = std::uint32_t(p0 >> 32) ^ x[3][j] ^ key[1];
+                x[0][j] = y0;
+                x[1][j] = std::uint32_t(p1);
+                x[2][j] = y2;
+                x[3][j] = std::uint32_t(p0);
+            }
+            key[0] += w0;
+            key[1] += w1;
+        }
+    }
+
+    /**
+     * Generate blocks [block, block + n) of this stream, with x[w][j] holding word w of block + j.
+     */
+    template<std::size_t n>
+    void blocks(std::uint64_t block, std::uint32_t (&x)[4][n]) const {
+        for (std::size_t j = 0; j < n; ++j) {
+            x[0][j] = std::uint32_t(block + j);
+            x[1][j] = std::uint32_t((block + j) >> 32);
+            x[2][j] = std::uint32_t(stream_);
+            x[3][j] = std::uint32_t(stream_ >> 32);
+        }
+        encrypt(x, Key{std::uint32_t(seed_), std::uint32_t(seed_ >> 32)});
+    }
+
+    void loadBlock() {
+        std::uint32_t x[4][1];
+        blocks(offset_ / 4, x);
+        for (int w = 0; w < 4; ++w) {
+            block_[w] = x[w][0];
+        }
+    }
+
+public:
+    Philox(std::uint64_t seed, std::uint64_t stream = 0, std::uint64_t offset = 0)
+            : seed_(seed), stream_(stream), offset_(offset), block_() {
+        loadBlock();
+    }
+
+    /**
+     * The raw Philox4x32-10 bijection, for checking against published test vectors.
+     */
+    static Counter block(Counter counter, Key key) {
+        std::uint32_t x[4][1];
+        for (int w = 0; w < 4; ++w) {
+            x[w][0] = counter[w];
+        }
+        encrypt(x, key);
+        return Counter{x[0][0], x[1][0], x[2][0], x[3][0]};
+    }
+
+    /**
+     * The seed named by the first command-line argument, or a fresh one from std::random_device.  Exits with a usage
+     * line if the argument is not a number.
+     */
+    static std::uint64_t seedFromCommandLine(int argc, char **argv) {
+        if (argc > 1) {
+            try {
+                std::size_t end = 0;
+                std::uint64_t seed = std::stoull(argv[1], &end, 0);
+                if ('\0' == argv[1][end] && '-' != argv[1][0]) {
+                    return seed;
+                }
+            } catch (std::logic_error const &) {
+            }
+            std::cerr << "usage: " << argv[0] << " [seed]" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        std::random_device rd;
+        return std::uint64_t(rd()) << 32 | rd();
+    }
+
+    static constexpr result_type min() {
+        return std::numeric_limits<result_type>::min();
+    }
+
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+        result_type result = block_[offset_ % 4];
+        if (0 == ++offset_ % 4) {
+            loadBlock();
+        }
+        return result;
+    }
+
+    /**
+     * Write the next count words of the stream to out; the same words operator() would have returned one at a time.
+     */
+    void fill(result_type *out, std::size_t count) {
+        while (count && 0 != offset_ % 4) {
+            *out++ = (*this)();
+            --count;
+        }
+
+        std::uint32_t x[4][lanes];
+        for (; count >= 4 * lanes; count -= 4 * lanes) {
+            blocks(offset_ / 4, x);
+            for (std::size_t j = 0; j < lanes; ++j) {
+                for (int w = 0; w < 4; ++w) {
+                    *out++ = x[w][j];
+                }
+            }
+            offset_ += 4 * lanes;
+        }
+
+        loadBlock();
+        while (count--) {
+            *out++ = (*this)();
+        }
+    }
+
+    void discard(std::uint64_t count) {
+        offset_ += count;
+        loadBlock();
+    }
+
+    /**
+     * A generator for another stream under the same seed, starting at its first word.
+     */
+    Philox split(std::uint64_t stream) const {
+        return Philox(seed_, stream);
+    }
+
+    std::uint64_t seed() const {
+        return seed_;
+    }
+
+    std::uint64_t stream() const {
+        return stream_;
+    }
+
+    std::uint64_t offset() const {
+        return offset_;
+    }
+};
+
+#endif /* MSC_PHILOX_HPP */
@@ -0,0 +1,47 @@
+#define BOOST_TEST_MODULE philox
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <cstdint>
+#include "philox.hpp"
+
+/**
+ * The philox4x32_10 known-answer vectors from Random123 (kat_vectors).
+ */
+BOOST_AUTO_TEST_CASE(known_answers) {
+    BOOST_TEST((Philox::block({0, 0, 0, 0}, {0, 0}) ==
+                Philox::Counter{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+    BOOST_TEST((Philox::block({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}) ==
+                Philox::Counter{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+    BOOST_TEST((Philox::block({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}) ==
+                Philox::Counter{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+}
+
+BOOST_AUTO_TEST_CASE(fill_matches_single_draws) {
+    for (std::uint64_t offset : {0, 1, 2, 3, 4, 5, 31, 33}) {
+        for (std::size_t count : {0, 1, 3, 4, 5, 31, 32, 33, 63, 64, 65, 257}) {
+            Philox bulk(0x6d7363, 7, offset);
+            Philox single(0x6d7363, 7, offset);
+
+            std::vector<std::uint32_t> words(count);
+            bulk.fill(words.data(), words.size());
+
+            for (std::size_t i = 0; i < count; ++i) {
+                BOOST_TEST(words[i] == single(), "offset " << offset << ", count " << count << ", word " << i);
+            }
+            BOOST_TEST(bulk.offset() == single.offset());
+            BOOST_TEST(bulk() == single());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(discard_matches_offset) {
+    for (std::uint64_t n : {0, 1, 3, 4, 5, 127, 1 << 20}) {
+        Philox discarded(42, 3);
+        discarded.discard(n);
+        Philox entered(42, 3, n);
+
+        for (int i = 0; i < 40; ++i) {
+            BOOST_TEST(discarded() == entered(), "n " << n << ", word " << i);
+        }
+    }
+}
@@ -1,14 +1,9 @@
 #include "rc4.hpp"
-#include <random>
 #include <iomanip>
 #include <iostream>
 
 int main(void) {
 
-    std::mt19937 prng;
-    prng.seed(std::random_device()());
-    std::uniform_int_distribution<std::uint8_t> dist;
-
     Rc4::Key k{
             0x01, 0x02, 0x03, 0x04,
             0x05, 0x06, 0x07, 0x08,
@@ -0,0 +1,123 @@
+#ifndef MSC_RC5PLUS_HPP
+#define MSC_RC5PLUS_HPP
+
+#include <bit>
+#include <tuple>
+#include <iostream>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "philox.hpp"
+#include "telemetry.hpp"
+
+namespace rc5plus {
+    using namespace std;
+
+    typedef uint16_t HalfBlock;
+    typedef HalfBlock Key;
+    typedef vector<Key> Keys;
+    typedef tuple<HalfBlock, HalfBlock> Block;
+    typedef vector<Block> Blocks;
+
+    inline Block operator^(Block const &lhs, Block const &rhs) {
+        return make_tuple(
+                get<0>(lhs) ^ get<0>(rhs),
+                get<1>(lhs) ^ get<1>(rhs)
+        );
+    }
+
+    inline constexpr HalfBlock e(int i) {
+        assert(i < 16);
+        return uint16_t(1) << i;
+    }
+
+    inline Block roundFunction(Key k, Block xy) {
+        auto &x = get<0>(xy);
+        auto &y = get<1>(xy);
+        y ^= x;
+        x = rotl(x, y & 15);
+        x ^= k;
+        return make_tuple(y, x);
+    }
+
+    inline void encrypt(Keys const &keys, Block plaintext, Blocks &output) {
+        output.resize(0);
+        output.push_back(plaintext);
+        for (auto k : keys) {
+            output.push_back(roundFunction(k, output.back()));
+        }
+    }
+
+    struct Tester {
+        Philox prng;
+        Blocks const characteristic;
+        vector<uint32_t> plaintexts;
+
+        HalfBlock randomHalfBlock() {
+            return HalfBlock(prng());
+        }
+
+    public:
+        Tester(uint64_t seed)
+                : prng(seed),
+                  characteristic{
+                          Block(e(15), e(15)),
+                          Block(0, e(15)),
+                          Block(e(15), 0),
+                          Block(e(15), e(15)),
+                          Block(0, e(15)),
+                          Block(e(15), 0),
+                          Block(e(15), e(15))
+                  },
+                  plaintexts(1 << 20) {
+        }
+
+        void runTest(vector<uint32_t> &results) {
+            results.resize(characteristic.size());
+
+            vector<uint16_t> keys;
+            generate_n(
+                    back_inserter(keys),
+                    characteristic.size() - 1,
+                    bind(&Tester::randomHalfBlock, this)
+            );
+
+            Blocks result1, result2;
+
+            /**
+             * One word per plaintext, drawn in bulk.
+             */
+            {
+                MSC_PHASE("runTest/generate");
+                prng.fill(plaintexts.data(), plaintexts.size());
+            }
+
+            MSC_PHASE("runTest/trace");
+            telemetry::Batch batch;
+            for (auto w : plaintexts) {
+                batch.add(telemetry::pairsEncrypted, 1);
+                batch.next();
+                result1.resize(0);
+                result2.resize(0);
+
+                Block a1(HalfBlock(w >> 16), HalfBlock(w));
+                Block a2 = (a1 ^ characteristic.front());
+
+                encrypt(keys, a1, result1);
+                encrypt(keys, a2, result2);
+
+                for (int i = 0, e = characteristic.size(); i < e; ++i) {
+                    if ((result1[i] ^ result2[i]) == characteristic[i]) {
+                        ++results[i];
+                    } else {
+                        break;
+                    }
+                }
+            }
+        }
+    };
+}
+
+#endif /* MSC_RC5PLUS_HPP */
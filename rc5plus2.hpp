@@ -0,0 +1,775 @@
+#ifndef MSC_RC5PLUS2_HPP
+#define MSC_RC5PLUS2_HPP
+
+#include <bit>
+#include <map>
+#include <array>
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iomanip>
+#include <cstdint>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include "philox.hpp"
+#include "telemetry.hpp"
+
+namespace rc5plus2 {
+    using namespace std;
+    using namespace std::placeholders;
+
+    typedef uint16_t HalfBlock;
+    typedef tuple<HalfBlock, HalfBlock> Block;
+    typedef HalfBlock Key;
+    typedef vector<Key> Keys;
+    typedef vector<Block> Blocks;
+    typedef tuple<Block, Block> BlockPair;
+
+    /**
+     * A plaintext pair together with the states reached so far by peeling rounds off its ciphertext pair.
+     */
+    struct PeeledPair {
+        BlockPair plaintexts;
+        BlockPair states;
+    };
+
+    typedef vector<PeeledPair> PeeledPairs;
+
+    inline Keys randomKeySchedule(Philox &prng) {
+        Keys result;
+        generate_n(back_inserter(result), 10, [&]() { return HalfBlock(prng()); });
+        return result;
+    }
+
+    inline Block operator^(Block const &lhs, Block const &rhs) {
+        return make_tuple(
+                get<0>(lhs) ^ get<0>(rhs),
+                get<1>(lhs) ^ get<1>(rhs)
+        );
+    }
+
+    inline constexpr HalfBlock e(int i) {
+        assert(i < 16);
+        return HalfBlock(1) << i;
+    }
+
+    class Cipher {
+        Keys const keys_;
+
+        typedef HalfBlock (*KeyCombiner)(HalfBlock, HalfBlock);
+
+        inline static HalfBlock xor_(HalfBlock x, HalfBlock k) {
+            return x ^ k;
+        }
+
+        inline static HalfBlock add_(HalfBlock x, HalfBlock k) {
+            return x + k;
+        }
+
+        inline static HalfBlock sub_(HalfBlock x, HalfBlock k) {
+            return x - k;
+        }
+
+        inline static Block roundFunction(KeyCombiner combineKey, Key k, Block xy) {
+            auto &x = get<0>(xy);
+            auto &y = get<1>(xy);
+            y ^= x;
+            x = rotl(x, y & 15);
+            x = combineKey(x, k);
+            return make_tuple(y, x);
+        }
+
+        /**
+         * Undo roundFunction(); separateKey must be the inverse of the combineKey used to encrypt.
+         */
+        inline static Block inverseRoundFunction(KeyCombiner separateKey, Key k, Block yx) {
+            auto &y = get<0>(yx);
+            auto &x = get<1>(yx);
+            x = rotr(separateKey(x, k), y & 15);
+            y ^= x;
+            return make_tuple(x, y);
+        }
+
+    public:
+        inline explicit Cipher(Keys const &keys)
+                : keys_(keys) {
+            assert(10 == keys_.size());
+        }
+
+        /**
+         * Apply round `round` (numbered from 1) to a single state.
+         */
+        inline static Block encryptRound(int round, Key k, Block xy) {
+            return roundFunction(round < 10 ? xor_ : add_, k, xy);
+        }
+
+        /**
+         * Undo round `round` (numbered from 1) of a single state.
+         */
+        inline static Block decryptRound(int round, Key k, Block yx) {
+            return inverseRoundFunction(round < 10 ? xor_ : sub_, k, yx);
+        }
+
+        inline void encrypt(Block plaintext, Blocks &result) const {
+            result.resize(0);
+            result.push_back(plaintext);
+
+            for (int i = 0; i < 9; ++i) {
+                result.push_back(roundFunction(xor_, keys_[i], result.back()));
+            }
+
+            result.push_back(roundFunction(add_, keys_.back(), result.back()));
+        }
+    };
+
+    /**
+     * A fixed set of worker threads draining a shared stack of tasks.  Tasks may submit further tasks, which run
+     * newest first so that a search goes depth first, and wait() returns once the stack is empty and every worker is
+     * idle.
+     */
+    class ThreadPool {
+        mutex mutex_;
+        condition_variable changed_;
+        vector<function<void()>> tasks_;
+        int busy_;
+        bool stopping_;
+        vector<thread> workers_;
+
+        inline void work() {
+            unique_lock<mutex> lock(mutex_);
+            for (;;) {
+                changed_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+
+                auto task = move(tasks_.back());
+                tasks_.pop_back();
+                ++busy_;
+                lock.unlock();
+                task();
+                lock.lock();
+                --busy_;
+                changed_.notify_all();
+            }
+        }
+
+    public:
+        inline explicit ThreadPool(unsigned threadCount = max(1u, thread::hardware_concurrency()))
+                : busy_(0),
+                  stopping_(false) {
+            generate_n(back_inserter(workers_), threadCount, [this]() { return thread(&ThreadPool::work, this); });
+        }
+
+        inline ~ThreadPool() {
+            {
+                lock_guard<mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            changed_.notify_all();
+            for_each(workers_.begin(), workers_.end(), mem_fn(&thread::join));
+        }
+
+        inline void submit(function<void()> task) {
+            {
+                lock_guard<mutex> lock(mutex_);
+                tasks_.push_back(move(task));
+            }
+            changed_.notify_all();
+        }
+
+        inline void wait() {
+            unique_lock<mutex> lock(mutex_);
+            changed_.wait(lock, [this]() { return tasks_.empty() && 0 == busy_; });
+        }
+    };
+
+    struct Attack {
+        Philox &prng;
+        Cipher &cipher;
+
+        /**
+         * Draw count random plaintexts in one pass over the generator, one 32-bit word per block.
+         */
+        inline Blocks randomBlocks(size_t count) {
+            vector<uint32_t> words(count);
+            prng.fill(words.data(), words.size());
+
+            Blocks result;
+            result.reserve(count);
+            for (auto w : words) {
+                result.emplace_back(HalfBlock(w >> 16), HalfBlock(w));
+            }
+            return result;
+        }
+
+        /**
+         * Filter ciphertext pairs that have zero difference in the leftmost 16 state_.  Accesses only the ciphertext.
+         */
+        inline bool filter(tuple<Blocks, Blocks> const &encryptionResults) const {
+            assert(11 == get<0>(encryptionResults).size());
+            assert(11 == get<1>(encryptionResults).size());
+            return get<0>(get<0>(encryptionResults).back()) == get<0>(get<1>(encryptionResults).back());
+        }
+
+        /**
+         * Determine whether a pair of ciphertexts is a right pair. Accesses the result of round 9.
+         */
+        inline bool isRightPair(tuple<Blocks, Blocks> const &encryptionResults) const {
+            auto &c0 = get<0>(encryptionResults);
+            auto &c1 = get<1>(encryptionResults);
+            auto d = (c0[9] ^ c1[9]);
+            return get<0>(d) == get<1>(d) && 1 == popcount(get<0>(d));
+        }
+
+        /**
+         * A partially recovered key schedule.  The keys of every round above `round` are known and have been peeled
+         * off the states of every pair in `pairs`, which holds only the pairs still consistent with the
+         * characteristic.  Siblings share their parent's pairs, so nothing is ever decrypted from the ciphertext twice.
+         */
+        struct Branch {
+            Keys keys;
+            int round;
+            shared_ptr<PeeledPairs const> pairs;
+        };
+
+        /**
+         * A score together with guesses for the keys of consecutive rounds, highest round first.
+         */
+        typedef tuple<uint64_t, Keys> Candidate;
+
+        /**
+         * State shared by every branch of one recoverKeySchedule() call.  The pool is declared last so that its
+         * workers have stopped before anything they use is destroyed.
+         *
+         * The dead ends are counted by the round of the branch that ended, for reportFailure(): branches left with
+         * too few pairs, children pruned by expand(), and full schedules that resolveEquivalentKeys() could not match
+         * to the known texts.
+         */
+        struct Search {
+            size_t const topK;
+            vector<BlockPair> knownTexts;
+            atomic<bool> done;
+            mutex resultMutex;
+            Keys result;
+            array<atomic<unsigned>, 11> starved{};
+            array<atomic<unsigned>, 11> pruned{};
+            atomic<unsigned> unresolved{};
+            ThreadPool pool;
+
+            inline explicit Search(size_t topK) : topK(topK), done(false) {
+            }
+        };
+
+        static constexpr size_t knownTextCount = 4;
+        static constexpr size_t minimumPairCount = 16;
+
+        inline static BlockPair peel(int round, Key k, BlockPair const &states) {
+            return BlockPair(
+                    Cipher::decryptRound(round, k, get<0>(states)),
+                    Cipher::decryptRound(round, k, get<1>(states))
+            );
+        }
+
+        /**
+         * Determine whether the round that produced a pair of states rotated both of them by zero.
+         */
+        inline static bool hasZeroRotation(BlockPair const &states) {
+            return 0 == (get<0>(get<0>(states)) & 15) && 0 == (get<0>(get<1>(states)) & 15);
+        }
+
+        /**
+         * Determine whether a pair peeled back to round 9 shows the difference (d, d), for a single bit d, of a right
+         * pair.  Unlike isRightPair() this sees only the peeled states.
+         */
+        inline static bool hasRightDifference9(BlockPair const &states) {
+            auto d = get<0>(states) ^ get<1>(states);
+            return get<0>(d) == get<1>(d) && 1 == popcount(get<0>(d));
+        }
+
+        /**
+         * Determine whether a pair peeled back to round 9 is a right pair that round 9 also rotated by zero, as the
+         * levels below round 10 require.
+         */
+        inline static bool isRightPair9(BlockPair const &states) {
+            return hasRightDifference9(states) && hasZeroRotation(states);
+        }
+
+        /**
+         * The bits of the key of round r fixed by the next checkpoint below a state s reached at round r: a zero
+         * rotation at round r - 1, or the plaintext itself when r is 1.  Returns (mask, value).
+         */
+        inline static tuple<HalfBlock, HalfBlock> keyConstraint(int round, Block s, Block const &plaintext) {
+            auto const a = get<0>(s);
+            auto const b = get<1>(s);
+            if (1 == round) {
+                return make_tuple(HalfBlock(0xffff), HalfBlock(b ^ rotl(get<0>(plaintext), a & 15)));
+            }
+
+            auto const mask = rotl(HalfBlock(15), a & 15);
+            return make_tuple(mask, HalfBlock(b & mask));
+        }
+
+        /**
+         * Higher scores first, and equal scores by their keys, so that which candidates make the top k does not
+         * depend on the order the pool threads deliver them in.
+         */
+        inline static bool better(Candidate const &lhs, Candidate const &rhs) {
+            if (get<0>(lhs) != get<0>(rhs)) {
+                return get<0>(lhs) > get<0>(rhs);
+            }
+            return get<1>(lhs) < get<1>(rhs);
+        }
+
+        /**
+         * Keep the topK best candidates in a heap whose front is the worst of them.
+         */
+        inline static void keepBest(vector<Candidate> &best, size_t topK, Candidate &&candidate) {
+            if (best.size() < topK) {
+                best.push_back(move(candidate));
+                push_heap(best.begin(), best.end(), better);
+            } else if (better(candidate, best.front())) {
+                pop_heap(best.begin(), best.end(), better);
+                best.back() = move(candidate);
+                push_heap(best.begin(), best.end(), better);
+            }
+        }
+
+        inline static vector<Candidate> sortedBest(vector<Candidate> &&best) {
+            sort_heap(best.begin(), best.end(), better);
+            return move(best);
+        }
+
+        /**
+         * Rank every key for round 10 by how many pairs it peels back to the difference of a right pair, breaking ties
+         * by how many of those pairs are also rotated by zero.  The difference cannot see the top bit of the key, but
+         * the rotation can.
+         */
+        inline static vector<Candidate> rankKey10(PeeledPairs const &pairs, size_t topK) {
+            MSC_PHASE("rankKey10");
+            vector<Candidate> best;
+            for (int k = 0; k < 1 << 16; ++k) {
+                MSC_COUNT(keysScored, 1);
+                uint64_t rightDifferenceCount = 0, rightPairCount = 0;
+                for (auto const &pair : pairs) {
+                    auto states = peel(10, k, pair.states);
+                    if (hasRightDifference9(states)) {
+                        ++rightDifferenceCount;
+                        rightPairCount += hasZeroRotation(states) ? 1 : 0;
+                    }
+                }
+                keepBest(best, topK, Candidate(rightDifferenceCount << 32 | rightPairCount, Keys{Key(k)}));
+            }
+            return sortedBest(move(best));
+        }
+
+        /**
+         * The constraints keyConstraint() puts on the key of round r-2 through each pair, given guesses for the keys of
+         * rounds r and r-1.
+         */
+        inline static void keyConstraints(int round, Key high, Key middle, PeeledPairs const &pairs,
+                                          vector<tuple<HalfBlock, HalfBlock>> &constraints) {
+            constraints.resize(pairs.size());
+            for (size_t i = 0; i < pairs.size(); ++i) {
+                auto s = Cipher::decryptRound(round, high, get<0>(pairs[i].states));
+                s = Cipher::decryptRound(round - 1, middle, s);
+                constraints[i] = keyConstraint(round - 2, s, get<0>(pairs[i].plaintexts));
+            }
+        }
+
+        /**
+         * The count keys that the most constraints allow, most allowed first, each with how many allow it.
+         */
+        inline static vector<tuple<unsigned long, Key>>
+        bestKeys(vector<tuple<HalfBlock, HalfBlock>> const &constraints, size_t count) {
+            vector<unsigned long> allowed(1 << 16);
+            for (auto const &[mask, value] : constraints) {
+                HalfBlock const free = ~mask;
+                HalfBlock bits = 0;
+                do {
+                    ++allowed[value | bits];
+                    bits = (bits - free) & free;
+                } while (bits);
+            }
+
+            vector<tuple<unsigned long, Key>> result;
+            for (int k = 0; k < 1 << 16; ++k) {
+                result.emplace_back(allowed[k], k);
+            }
+            partial_sort(result.begin(), result.begin() + count, result.end(), greater<>());
+            result.resize(count);
+            return result;
+        }
+
+        /**
+         * Rank guesses for the keys of rounds r, r-1 and r-2 by how many pairs they make consistent with the
+         * characteristic at round r-3.  Only the low 4 bits of the key of round r are guessed (see
+         * recoverKeySchedule()), and this ranks a single guess of them so that the 16 guesses can run in parallel.
+         *
+         * Trying every key of round r-2 for every guess would cost another factor of 2^16, so the guesses are first
+         * ranked with the bitwise majority over the bits each pair constrains.  When wrong pairs are common the
+         * majority can get a bit or two wrong, and a few of them can even outnumber the right pairs, so the topK
+         * guesses that survive are ranked again with each of the topK keys of round r-2 that the most pairs allow.
+         */
+        inline static vector<Candidate> rankGroup(int round, Key high, PeeledPairs const &pairs, size_t topK) {
+            MSC_PHASE("rankGroup");
+            vector<Candidate> best;
+            vector<Block> peeled(pairs.size());
+            vector<tuple<HalfBlock, HalfBlock>> constraints(pairs.size());
+
+            for (size_t i = 0; i < pairs.size(); ++i) {
+                peeled[i] = Cipher::decryptRound(round, high, get<0>(pairs[i].states));
+            }
+
+            for (int middle = 0; middle < 1 << 16; ++middle) {
+                MSC_COUNT(keysScored, 1);
+                array<unsigned, 16> votes{}, ones{};
+
+                for (size_t i = 0; i < pairs.size(); ++i) {
+                    auto s = Cipher::decryptRound(round - 1, middle, peeled[i]);
+                    constraints[i] = keyConstraint(round - 2, s, get<0>(pairs[i].plaintexts));
+
+                    auto const [mask, value] = constraints[i];
+                    for (HalfBlock m = mask; m; m &= m - 1) {
+                        int bit = countr_zero(m);
+                        ++votes[bit];
+                        ones[bit] += (value >> bit) & 1;
+                    }
+                }
+
+                HalfBlock low = 0;
+                for (int bit = 0; bit < 16; ++bit) {
+                    if (2 * ones[bit] > votes[bit]) {
+                        low |= e(bit);
+                    }
+                }
+
+                unsigned long score = count_if(constraints.begin(), constraints.end(), [low](auto const &c) {
+                    return 0 == ((get<1>(c) ^ low) & get<0>(c));
+                });
+                keepBest(best, topK, Candidate(score, Keys{high, Key(middle), low}));
+            }
+
+            vector<Candidate> refined;
+            for (auto const &[score, keys] : best) {
+                keyConstraints(round, keys[0], keys[1], pairs, constraints);
+                for (auto const &[allowed, low] : bestKeys(constraints, topK)) {
+                    keepBest(refined, topK, Candidate(allowed, Keys{keys[0], keys[1], low}));
+                }
+            }
+            return refined;
+        }
+
+        /**
+         * On right pairs every rotation at rounds 3, 6 and 9 is by zero, so xoring the same multiple of 16 into the
+         * keys of rounds 7-9 leaves the state at round 6 unchanged, and likewise for rounds 4-6 (round 3) and 1-3
+         * (the plaintext).  Find the three offsets under which keys also encrypts the known texts, by meeting in the
+         * middle at round 6.
+         */
+        inline static bool resolveEquivalentKeys(Keys &keys, vector<BlockPair> const &knownTexts) {
+            MSC_PHASE("resolveEquivalentKeys");
+            auto const &plaintext = get<0>(knownTexts.front());
+            auto const &ciphertext = get<1>(knownTexts.front());
+            auto signature = [](Block const &s) { return uint32_t(get<0>(s)) << 16 | get<1>(s); };
+            auto offsetKey = [&keys](int round, HalfBlock offset) { return Key(keys[round - 1] ^ offset); };
+
+            unordered_multimap<uint32_t, HalfBlock> fromAbove;
+            for (int i = 0; i < 1 << 12; ++i) {
+                HalfBlock offset = i << 4;
+                Block s = Cipher::decryptRound(10, keys[9], ciphertext);
+                for (int round = 9; round > 6; --round) {
+                    s = Cipher::decryptRound(round, offsetKey(round, offset), s);
+                }
+                fromAbove.emplace(signature(s), offset);
+            }
+
+            vector<Block> fromBelow(1 << 12);
+            for (int i = 0; i < 1 << 12; ++i) {
+                HalfBlock offset = i << 4;
+                fromBelow[i] = plaintext;
+                for (int round = 1; round < 4; ++round) {
+                    fromBelow[i] = Cipher::encryptRound(round, offsetKey(round, offset), fromBelow[i]);
+                }
+            }
+
+            Blocks encryptionResult;
+            for (int i = 0; i < 1 << 12; ++i) {
+                HalfBlock offset456 = i << 4;
+                for (int j = 0; j < 1 << 12; ++j) {
+                    Block s = fromBelow[j];
+                    for (int round = 4; round < 7; ++round) {
+                        s = Cipher::encryptRound(round, offsetKey(round, offset456), s);
+                    }
+
+                    auto matches = fromAbove.equal_range(signature(s));
+                    for (auto match = matches.first; match != matches.second; ++match) {
+                        HalfBlock offset123 = j << 4;
+                        Keys candidate = keys;
+                        for (int round = 1; round < 10; ++round) {
+                            candidate[round - 1] ^= round < 4 ? offset123 : round < 7 ? offset456 : match->second;
+                        }
+
+                        Cipher cipher(candidate);
+                        bool verified = all_of(knownTexts.begin(), knownTexts.end(), [&](BlockPair const &text) {
+                            cipher.encrypt(get<0>(text), encryptionResult);
+                            return encryptionResult.back() == get<1>(text);
+                        });
+                        if (verified) {
+                            keys = candidate;
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Hand one child of branch per candidate back to the pool, so that the best one runs first.  Each child gets
+         * the branch's pairs peeled by the candidate's rounds and restricted to those that remain consistent with the
+         * characteristic.  Candidates that keep fewer than half as many pairs as the best one are not worth a branch.
+         */
+        inline static void expand(Search &search, Branch const &branch, vector<Candidate> const &candidates) {
+            vector<Branch> children;
+            size_t bestPairCount = 0;
+
+            for (auto const &[score, keys] : candidates) {
+                Branch child{branch.keys, branch.round - int(keys.size()), nullptr};
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    child.keys[branch.round - 1 - i] = keys[i];
+                }
+
+                auto pairs = make_shared<PeeledPairs>();
+                for (auto pair : *branch.pairs) {
+                    for (int round = branch.round; round > child.round; --round) {
+                        pair.states = peel(round, child.keys[round - 1], pair.states);
+                    }
+
+                    bool consistent = 10 == branch.round ? isRightPair9(pair.states)
+                                                         : 0 == child.round ? pair.states == pair.plaintexts
+                                                                            : hasZeroRotation(pair.states);
+                    if (consistent) {
+                        pairs->push_back(pair);
+                    }
+                }
+
+                bestPairCount = max(bestPairCount, pairs->size());
+                child.pairs = move(pairs);
+                children.push_back(move(child));
+            }
+
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                if (2 * child->pairs->size() >= bestPairCount) {
+                    search.pool.submit([&search, child = *child]() { explore(search, child); });
+                } else {
+                    ++search.pruned[child->round];
+                }
+            }
+        }
+
+        /**
+         * Rank the keys of the rounds below branch and expand() it.  The 16 slices of a three-round level are ranked
+         * as separate tasks, and whichever finishes last merges them.
+         */
+        inline static void explore(Search &search, Branch const &branch) {
+            if (search.done) {
+                return;
+            }
+
+            if (branch.pairs->size() < minimumPairCount) {
+                ++search.starved[branch.round];
+                return;
+            }
+
+            if (0 == branch.round) {
+                Keys keys = branch.keys;
+                if (resolveEquivalentKeys(keys, search.knownTexts)) {
+                    lock_guard<mutex> lock(search.resultMutex);
+                    search.result = keys;
+                    search.done = true;
+                } else {
+                    ++search.unresolved;
+                }
+                return;
+            }
+
+            if (10 == branch.round) {
+                expand(search, branch, rankKey10(*branch.pairs, search.topK));
+                return;
+            }
+
+            struct Ranking {
+                mutex mutex_;
+                vector<Candidate> best;
+                int remaining = 16;
+            };
+
+            auto ranking = make_shared<Ranking>();
+            for (int high = 0; high < 16; ++high) {
+                search.pool.submit([&search, branch, ranking, high]() {
+                    if (search.done) {
+                        return;
+                    }
+
+                    auto slice = rankGroup(branch.round, high, *branch.pairs, search.topK);
+
+                    unique_lock<mutex> lock(ranking->mutex_);
+                    for (auto &candidate : slice) {
+                        keepBest(ranking->best, search.topK, move(candidate));
+                    }
+                    if (0 == --ranking->remaining) {
+                        lock.unlock();
+                        expand(search, branch, sortedBest(move(ranking->best)));
+                    }
+                });
+            }
+        }
+
+        /**
+         * Say where every branch of a failed search ended, lowest round first; the first line names the level that
+         * pruned the last branches.
+         */
+        inline static void reportFailure(Search const &search) {
+            cout << dec;
+            cout << "no key schedule found:" << endl;
+            if (0 < search.unresolved) {
+                cout << "  " << search.unresolved << " schedule(s) matched no known text in resolveEquivalentKeys()"
+                     << endl;
+            }
+            for (int round = 0; round <= 10; ++round) {
+                if (0 < search.starved[round]) {
+                    cout << "  round " << round << ": " << search.starved[round] << " branch(es) kept fewer than "
+                         << minimumPairCount << " pairs" << endl;
+                }
+                if (0 < search.pruned[round]) {
+                    cout << "  round " << round << ": " << search.pruned[round]
+                         << " branch(es) pruned with under half the best pair count" << endl;
+                }
+            }
+        }
+
+    public:
+        inline Attack(Philox &prng, Cipher &cipher) :
+                prng(prng),
+                cipher(cipher) {
+        }
+
+        inline Key recoverKey10() {
+            vector<tuple<Blocks, Blocks>> rightPairCandidates;
+            tuple<Blocks, Blocks> encryptionResults;
+
+            /**
+             * Generate 2^20 plaintext pairs with xor difference (e15,e15) and filter using filter() above. These are
+             * our right pair candidates.
+             */
+            {
+                MSC_PHASE("recoverKey10/collect");
+                telemetry::Batch batch;
+                for (auto plaintext : randomBlocks(1 << 20)) {
+                    cipher.encrypt(plaintext, get<0>(encryptionResults));
+                    cipher.encrypt(plaintext ^ Block(e(15), e(15)), get<1>(encryptionResults));
+                    batch.add(telemetry::pairsEncrypted, 1);
+                    if (filter(encryptionResults)) {
+                        batch.add(telemetry::pairsFiltered, 1);
+                        rightPairCandidates.push_back(encryptionResults);
+                    }
+                    batch.next();
+                }
+            }
+
+            /**
+             * Report how many pairs passed the filter and how many were actually right pairs.
+             */
+            auto filterCount = rightPairCandidates.size();
+            auto rightPairCount = count_if(
+                    rightPairCandidates.begin(),
+                    rightPairCandidates.end(),
+                    bind(&Attack::isRightPair, this, _1)
+            );
+
+            cout << dec;
+            cout << filterCount << " pairs passed the filter of which " << rightPairCount << " are right pairs" << endl;
+
+            /**
+             * For each key for each right pair candidate, calculate a metric which will be 1 when k is the correct key
+             * and [0,16) otherwise.  The total of this metric is stored per key in weights.  Since E(hwt) > 1 in general
+             * but E(hwt) = 1 for the correct key, we expect the key with the lowest weight to be the correct key.
+             */
+            MSC_PHASE("recoverKey10/score");
+            array<unsigned long, 1 << 16> weights;
+            fill(weights.begin(), weights.end(), 0);
+
+            for (int k = 0; k < 1 << 16; ++k) {
+                MSC_COUNT(keysScored, 1);
+                for (auto &rightPairCandidate : rightPairCandidates) {
+                    HalfBlock const& N0 = get<1>(get<0>(rightPairCandidate).back());
+                    HalfBlock const& N1 = get<1>(get<1>(rightPairCandidate).back());
+                    weights[k] += popcount(HalfBlock(HalfBlock(N0 - k) ^ HalfBlock(N1 - k)));
+                }
+            }
+
+            return distance(weights.begin(), min_element(weights.begin(), weights.end()));
+        }
+
+        /**
+         * Recover the whole key schedule from a single batch of 2^20 plaintext pairs.  The pairs that pass filter()
+         * are kept, with their ciphertexts, as the cache of peeled states that every level works from.  Level 10
+         * ranks the keys of round 10 as in recoverKey10(); each later level peels three rounds at once, because the
+         * keys of xor rounds only show through the data-dependent rotation of the next round, and the first one whose
+         * rotation right pairs constrain is three rounds down.  The topK best candidates of each level are explored
+         * in parallel on a thread pool.
+         *
+         * The levels recover the keys of rounds 9, 6 and 3 with their high 12 bits clear; see resolveEquivalentKeys().
+         * Returns an empty schedule, after reporting where the branches ended, if no branch survives.
+         */
+        inline Keys recoverKeySchedule(size_t topK = 4) {
+            assert(0 < topK);
+            Search search(topK);
+            auto pairs = make_shared<PeeledPairs>();
+            tuple<Blocks, Blocks> encryptionResults;
+
+            {
+                MSC_PHASE("recoverKeySchedule/collect");
+                telemetry::Batch batch;
+                for (auto plaintext : randomBlocks(1 << 20)) {
+                    BlockPair plaintexts(plaintext, Block());
+                    get<1>(plaintexts) = get<0>(plaintexts) ^ Block(e(15), e(15));
+                    cipher.encrypt(get<0>(plaintexts), get<0>(encryptionResults));
+                    cipher.encrypt(get<1>(plaintexts), get<1>(encryptionResults));
+                    batch.add(telemetry::pairsEncrypted, 1);
+
+                    if (search.knownTexts.size() < knownTextCount) {
+                        search.knownTexts.emplace_back(get<0>(plaintexts), get<0>(encryptionResults).back());
+                    }
+
+                    if (filter(encryptionResults)) {
+                        batch.add(telemetry::pairsFiltered, 1);
+                        BlockPair ciphertexts(get<0>(encryptionResults).back(), get<1>(encryptionResults).back());
+                        pairs->push_back(PeeledPair{plaintexts, ciphertexts});
+                    }
+                    batch.next();
+                }
+            }
+
+            cout << dec;
+            cout << pairs->size() << " pairs passed the filter" << endl;
+
+            search.pool.submit([&search, pairs]() { explore(search, Branch{Keys(10), 10, pairs}); });
+            search.pool.wait();
+
+            if (search.result.empty()) {
+                reportFailure(search);
+            }
+            return search.result;
+        }
+    };
+}
+
+#endif /* MSC_RC5PLUS2_HPP */
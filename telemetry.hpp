@@ -0,0 +1,468 @@
+#ifndef MSC_TELEMETRY_HPP
+#define MSC_TELEMETRY_HPP
+
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <condition_variable>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Progress counters and phase timers for the long-running searches, and a Reporter that publishes them while the
+ * search runs.  Code bumps a counter with MSC_COUNT(counter, n) and times a scope with MSC_PHASE("name"); without
+ * MSC_TELEMETRY defined both expand to nothing, and Batch and Reporter do nothing.  A count is a store to memory that
+ * the compiler cannot merge, so loops whose iterations take nanoseconds count through a Batch instead.
+ */
+namespace telemetry {
+    enum Counter {
+        pairsEncrypted,
+        pairsFiltered,
+        keysScored,
+        ivsTested,
+        counterCount
+    };
+
+    inline char const *counterName(int counter) {
+        static char const *const names[counterCount] = {
+                "pairs_encrypted",
+                "pairs_filtered",
+                "keys_scored",
+                "ivs_tested"
+        };
+        return names[counter];
+    }
+
+#ifdef MSC_TELEMETRY
+
+    static constexpr std::size_t maxPhases = 32;
+
+    /**
+     * The time stamp counter where there is one, nanoseconds elsewhere; Registry converts either to seconds.
+     */
+    inline std::uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * The counts of one thread.  Only that thread writes them, so an increment is a relaxed load and store rather
+     * than a locked read-modify-write, and the slot has a cache line of its own.
+     */
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> counts[counterCount];
+        std::atomic<std::uint64_t> phaseCycles[maxPhases];
+    };
+
+    struct Snapshot {
+        double seconds;
+        std::array<std::uint64_t, counterCount> counts;
+        std::array<std::uint64_t, counterCount> expected;
+        std::vector<std::pair<std::string, double>> phaseSeconds;
+    };
+
+    /**
+     * Every thread's slot and every phase name, for the life of the process; slots outlive their threads so that
+     * totals never go backwards.
+     */
+    class Registry {
+        std::mutex mutex_;
+        std::deque<Slot> slots_;
+        std::vector<std::string> phases_;
+        std::array<std::atomic<std::uint64_t>, counterCount> expected_;
+        std::chrono::steady_clock::time_point start_;
+        std::uint64_t startCycles_;
+
+        Registry() : start_(std::chrono::steady_clock::now()), startCycles_(cycles()) {
+        }
+
+    public:
+        static Registry &instance() {
+            static Registry registry;
+            return registry;
+        }
+
+        Slot &addSlot() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return slots_.emplace_back();
+        }
+
+        int phaseId(char const *name) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < phases_.size(); ++i) {
+                if (phases_[i] == name) {
+                    return int(i);
+                }
+            }
+            if (maxPhases == phases_.size()) {
+                std::cerr << "telemetry: too many phases, not timing " << name << std::endl;
+                std::abort();
+            }
+            phases_.emplace_back(name);
+            return int(phases_.size() - 1);
+        }
+
+        void expect(Counter counter, std::uint64_t count) {
+            expected_[counter].fetch_add(count, std::memory_order_relaxed);
+        }
+
+        Snapshot snapshot() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Snapshot result{};
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+            double secondsPerCycle = result.seconds / double(std::max<std::uint64_t>(1, cycles() - startCycles_));
+
+            std::array<std::uint64_t, maxPhases> phaseCycles{};
+            for (auto const &slot : slots_) {
+                for (int c = 0; c < counterCount; ++c) {
+                    result.counts[c] += slot.counts[c].load(std::memory_order_relaxed);
+                }
+                for (std::size_t p = 0; p < phases_.size(); ++p) {
+                    phaseCycles[p] += slot.phaseCycles[p].load(std::memory_order_relaxed);
+                }
+            }
+            for (int c = 0; c < counterCount; ++c) {
+                result.expected[c] = expected_[c].load(std::memory_order_relaxed);
+            }
+            for (std::size_t p = 0; p < phases_.size(); ++p) {
+                result.phaseSeconds.emplace_back(phases_[p], double(phaseCycles[p]) * secondsPerCycle);
+            }
+            return result;
+        }
+    };
+
+    /**
+     * The calling thread's slot.  The pointer is constant-initialized so that reaching it needs no guard.
+     */
+    inline Slot &threadSlot() {
+        thread_local Slot *slot = nullptr;
+        if (!slot) {
+            slot = &Registry::instance().addSlot();
+        }
+        return *slot;
+    }
+
+    inline void count(Counter counter, std::uint64_t n) {
+        auto &value = threadSlot().counts[counter];
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /**
+     * Announce count more units of work for counter, so that the Reporter can estimate when the run will finish.
+     */
+    inline void expect(Counter counter, std::uint64_t count) {
+        Registry::instance().expect(counter, count);
+    }
+
+    /**
+     * Counts kept locally and passed on every size iterations of a loop, and when the Batch goes out of scope.  The
+     * default of 2^12 keeps the stores out of the iterations while still moving the totals many times per report.
+     */
+    class Batch {
+        std::array<std::uint64_t, counterCount> pending_;
+        std::uint64_t size_;
+        std::uint64_t iterations_;
+
+    public:
+        explicit Batch(std::uint64_t size = 1 << 12) : pending_(), size_(size), iterations_(0) {
+        }
+
+        Batch(Batch const &) = delete;
+
+        ~Batch() {
+            flush();
+        }
+
+        void add(Counter counter, std::uint64_t n) {
+            pending_[counter] += n;
+        }
+
+        /**
+         * End one iteration of the loop.
+         */
+        void next() {
+            if (0 == ++iterations_ % size_) {
+                flush();
+            }
+        }
+
+        void flush() {
+            for (int c = 0; c < counterCount; ++c) {
+                if (pending_[c]) {
+                    count(Counter(c), pending_[c]);
+                    pending_[c] = 0;
+                }
+            }
+        }
+    };
+
+    /**
+     * Charges the cycles between construction and destruction to a phase.
+     */
+    class PhaseTimer {
+        std::atomic<std::uint64_t> &total_;
+        std::uint64_t start_;
+
+    public:
+        explicit PhaseTimer(int phase) : total_(threadSlot().phaseCycles[phase]), start_(cycles()) {
+        }
+
+        PhaseTimer(PhaseTimer const &) = delete;
+
+        ~PhaseTimer() {
+            total_.store(total_.load(std::memory_order_relaxed) + (cycles() - start_), std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * A background thread that every MSC_TELEMETRY_INTERVAL seconds (default 5) prints each counter's total, rate
+     * and ETA and the share of time spent in each phase to stderr, and rewrites MSC_TELEMETRY_FILE if that is set:
+     * as JSON if the name ends in .json, otherwise in the Prometheus text format.  The file is replaced atomically so a
+     * scraper never sees half of it, and is written a last time when the Reporter is destroyed.
+     */
+    class Reporter {
+        double interval_;
+        std::string path_;
+        std::mutex mutex_;
+        std::condition_variable stop_;
+        bool stopping_;
+        bool fileFailing_;
+        Snapshot last_;
+        double lastProgress_;
+        std::thread thread_;
+
+        /**
+         * Seconds until counter c reaches the work announced with expect() at the given rate, or -1 if unknown.
+         */
+        static double etaOf(Snapshot const &now, int c, double rate) {
+            if (0 == now.expected[c] || now.counts[c] >= now.expected[c] || 0 == rate) {
+                return -1;
+            }
+            return double(now.expected[c] - now.counts[c]) / rate;
+        }
+
+        void writeStderr(Snapshot const &now, std::array<double, counterCount> const &rates) {
+            std::ostringstream line;
+            line.precision(3);
+            line << "[telemetry " << std::fixed << now.seconds << "s]" << std::defaultfloat;
+            for (int c = 0; c < counterCount; ++c) {
+                if (0 == now.counts[c]) {
+                    continue;
+                }
+                line << ' ' << counterName(c) << ' ' << now.counts[c] << " (" << rates[c] << "/s";
+                auto eta = etaOf(now, c, rates[c]);
+                if (0 <= eta) {
+                    line << ", " << 100. * double(now.counts[c]) / double(now.expected[c]) << "%, ETA " << eta << 's';
+                }
+                line << ')';
+            }
+
+            double phaseTotal = 0;
+            for (auto const &[name, seconds] : now.phaseSeconds) {
+                phaseTotal += seconds;
+            }
+            if (0 < phaseTotal) {
+                line << " |";
+                for (auto const &[name, seconds] : now.phaseSeconds) {
+                    line << ' ' << name << ' ' << 100. * seconds / phaseTotal << '%';
+                }
+            }
+
+            if (now.seconds - lastProgress_ >= interval_) {
+                line << " | no progress for " << now.seconds - lastProgress_ << 's';
+            }
+
+            std::cerr << line.str() << std::endl;
+        }
+
+        static void writeJson(std::ostream &o, Snapshot const &now, std::array<double, counterCount> const &rates) {
+            o << "{\n  \"elapsed_seconds\": " << now.seconds << ",\n  \"counters\": {";
+            for (int c = 0; c < counterCount; ++c) {
+                o << (c ? "," : "") << "\n    \"" << counterName(c) << "\": {\"total\": " << now.counts[c]
+                  << ", \"rate\": " << rates[c] << ", \"expected\": " << now.expected[c];
+                auto eta = etaOf(now, c, rates[c]);
+                if (0 <= eta) {
+                    o << ", \"eta_seconds\": " << eta;
+                }
+                o << '}';
+            }
+            o << "\n  },\n  \"phase_seconds\": {";
+            for (std::size_t p = 0; p < now.phaseSeconds.size(); ++p) {
+                o << (p ? "," : "") << "\n    \"" << now.phaseSeconds[p].first << "\": " << now.phaseSeconds[p].second;
+            }
+            o << "\n  }\n}\n";
+        }
+
+        static void writePrometheus(std::ostream &o, Snapshot const &now, std::array<double, counterCount> const &rates) {
+            o << "# TYPE msc_elapsed_seconds gauge\n";
+            o << "msc_elapsed_seconds " << now.seconds << '\n';
+            for (int c = 0; c < counterCount; ++c) {
+                o << "# TYPE msc_" << counterName(c) << "_total counter\n";
+                o << "msc_" << counterName(c) << "_total " << now.counts[c] << '\n';
+                o << "# TYPE msc_" << counterName(c) << "_per_second gauge\n";
+                o << "msc_" << counterName(c) << "_per_second " << rates[c] << '\n';
+                auto eta = etaOf(now, c, rates[c]);
+                if (0 <= eta) {
+                    o << "# TYPE msc_" << counterName(c) << "_eta_seconds gauge\n";
+                    o << "msc_" << counterName(c) << "_eta_seconds " << eta << '\n';
+                }
+            }
+            o << "# TYPE msc_phase_seconds_total counter\n";
+            for (auto const &[name, seconds] : now.phaseSeconds) {
+                o << "msc_phase_seconds_total{phase=\"" << name << "\"} " << seconds << '\n';
+            }
+        }
+
+        void writeFile(Snapshot const &now, std::array<double, counterCount> const &rates) {
+            if (path_.empty()) {
+                return;
+            }
+            std::string temporary = path_ + ".tmp";
+            bool written;
+            {
+                std::ofstream file(temporary);
+                if (path_.size() >= 5 && 0 == path_.compare(path_.size() - 5, 5, ".json")) {
+                    writeJson(file, now, rates);
+                } else {
+                    writePrometheus(file, now, rates);
+                }
+                file.close();
+                written = bool(file);
+            }
+            written = written && 0 == std::rename(temporary.c_str(), path_.c_str());
+
+            /**
+             * Say so once when the file stops being updated, and again only if it recovers and then fails again.
+             */
+            if (!written && !fileFailing_) {
+                std::cerr << "telemetry: could not write " << path_ << ": " << std::strerror(errno) << std::endl;
+            }
+            fileFailing_ = !written;
+        }
+
+        /**
+         * Rates are over the time since the previous report, so they show a stall as soon as it happens.
+         */
+        std::array<double, counterCount> update(Snapshot const &now) {
+            std::array<double, counterCount> rates{};
+            double elapsed = now.seconds - last_.seconds;
+            bool progress = false;
+            for (int c = 0; c < counterCount; ++c) {
+                rates[c] = 0 < elapsed ? double(now.counts[c] - last_.counts[c]) / elapsed : 0;
+                progress = progress || now.counts[c] != last_.counts[c];
+            }
+            if (progress) {
+                lastProgress_ = now.seconds;
+            }
+            last_ = now;
+            return rates;
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_.wait_for(lock, std::chrono::duration<double>(interval_), [this]() { return stopping_; })) {
+                auto now = Registry::instance().snapshot();
+                auto rates = update(now);
+                writeStderr(now, rates);
+                writeFile(now, rates);
+            }
+        }
+
+    public:
+        Reporter()
+                : interval_(5),
+                  path_(),
+                  stopping_(false),
+                  fileFailing_(false),
+                  last_(Registry::instance().snapshot()),
+                  lastProgress_(last_.seconds) {
+            if (char const *interval = std::getenv("MSC_TELEMETRY_INTERVAL")) {
+                interval_ = std::max(0.1, std::atof(interval));
+            }
+            if (char const *path = std::getenv("MSC_TELEMETRY_FILE")) {
+                path_ = path;
+            }
+            thread_ = std::thread(&Reporter::run, this);
+        }
+
+        Reporter(Reporter const &) = delete;
+
+        ~Reporter() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            stop_.notify_one();
+            thread_.join();
+
+            auto now = Registry::instance().snapshot();
+            auto rates = update(now);
+            writeFile(now, rates);
+        }
+    };
+
+#define MSC_TELEMETRY_CONCAT_(a, b) a##b
+#define MSC_TELEMETRY_CONCAT(a, b) MSC_TELEMETRY_CONCAT_(a, b)
+#define MSC_COUNT(counter, n) ::telemetry::count(::telemetry::counter, (n))
+#define MSC_PHASE(name) \
+    static int const MSC_TELEMETRY_CONCAT(mscPhaseId, __LINE__) = ::telemetry::Registry::instance().phaseId(name); \
+    ::telemetry::PhaseTimer MSC_TELEMETRY_CONCAT(mscPhaseTimer, __LINE__)(MSC_TELEMETRY_CONCAT(mscPhaseId, __LINE__))
+
+#else
+
+    inline void expect(Counter, std::uint64_t) {
+    }
+
+    class Batch {
+    public:
+        explicit Batch(std::uint64_t = 0) {
+        }
+
+        Batch(Batch const &) = delete;
+
+        void add(Counter, std::uint64_t) {
+        }
+
+        void next() {
+        }
+
+        void flush() {
+        }
+    };
+
+    class Reporter {
+    public:
+        Reporter() {
+        }
+
+        Reporter(Reporter const &) = delete;
+    };
+
+#define MSC_COUNT(counter, n) ((void) 0)
+#define MSC_PHASE(name) ((void) 0)
+
+#endif /* MSC_TELEMETRY */
+}
+
+#endif /* MSC_TELEMETRY_HPP */